@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2019 overbejt@miamioh.edu
+ *
+ * File: audit_ring.h
+ * Author: Josh Overbeck
+ * Description: A lock-free ring buffer for audit records.
+ *
+ * Transaction threads push fixed-size audit records into the ring and a
+ * single writer thread pops them.  Each slot carries a sequence number
+ * that says whether it is free for the producer at that position or
+ * filled for the consumer, so neither side ever takes a lock.
+ *
+ */
+
+#ifndef AUDIT_RING_H
+#define AUDIT_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// The transactions that are audited
+enum class AuditOp : uint8_t { Create, Credit, Debit, Reset };
+
+// Longest account number kept in a record.  Longer ones are cut short; the
+// record then also keeps their full length and a hash of them.
+const int AuditAcctLen = 26;
+
+/**
+ * One audit record (64 bytes).  The balance is NAN when the account was
+ * hot (striped) and so had no single resulting balance.
+ */
+struct AuditRecord {
+    int64_t timeNs;       // Nanoseconds since the epoch (coarse clock)
+    double amount;
+    double balance;
+    uint32_t clientAddr;  // IPv4 address of the client
+    uint32_t acctHash;    // Hash of the whole account number if cut short
+    uint16_t clientPort;
+    uint16_t acctFullLen; // Length of the whole account number
+    AuditOp op;
+    uint8_t acctLen;      // Bytes of the account number kept in acct
+    char acct[AuditAcctLen];
+};
+
+/**
+ * A bounded multi-producer, single-consumer ring of audit records.
+ */
+class AuditRing {
+public:
+    // Number of records the ring holds (a power of 2)
+    static const uint64_t Size = 1 << 16;
+
+    AuditRing() : slots(new Slot[Size]) {
+        for (uint64_t i = 0; (i < Size); i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Add a record to the ring.
+     *
+     * @param rec The record to add.
+     * @param block If the ring is full, wait for room instead of failing.
+     * @return false if the ring was full (and block is false).
+     */
+    bool push(const AuditRecord& rec, bool block) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & (Size - 1)];
+            const int64_t diff = static_cast<int64_t>(
+                slot.seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                // Slot is free: claim the position
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) {
+                    slot.rec = rec;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Slot still holds a record from the last lap: ring is full
+                if (!block) {
+                    return false;
+                }
+                std::this_thread::yield();
+                pos = tail.load(std::memory_order_relaxed);
+            } else {
+                // Another producer got here first
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest record from the ring.  Only one thread may pop.
+     *
+     * @param rec Set to the record.
+     * @return false if the ring is empty.
+     */
+    bool pop(AuditRecord& rec) {
+        Slot& slot = slots[head & (Size - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        rec = slot.rec;
+        slot.seq.store(head + Size, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        AuditRecord rec;
+    };
+    std::unique_ptr<Slot[]> slots;
+    // Next position for producers, padded onto a cache line of its own
+    char pad1[64];
+    std::atomic<uint64_t> tail{0};
+    char pad2[64];
+    // Next position for the consumer
+    uint64_t head = 0;
+};
+
+#endif  // AUDIT_RING_H
+
+// End of source code
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2019 overbejt@miamioh.edu
+ *
+ * File: bank_bench.cpp
+ * Author: Josh Overbeck
+ * Description: A Zipfian benchmark for hot accounts in the bank.
+ *
+ * This benchmark calls credit directly (no sockets) from several threads.
+ * Accounts are picked with a Zipfian distribution so a few accounts get
+ * most of the credits.  Each thread count is run with hot account striping
+ * turned off and on so the scaling can be compared.  It is linked with the
+ * server and run from its main:
+ *
+ *   g++ -std=c++14 -O2 -DZIPF_BENCH overbejt_hw8.cpp bank_bench.cpp \
+ *       -o bank_bench -lboost_system -lpthread
+ *   ./bank_bench [maxThreads] [opsPerThread] [numAccts] [theta]
+ *
+ * At the end it also reports the cost auditing adds to a credit (records
+ * go to bank_bench_audit.log).
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ctime>
+
+// Methods from overbejt_hw8.cpp that are exercised by the benchmark
+std::string createAcct(std::string acctNum);
+std::string credit(std::string acctNum, double ammount);
+std::string status(std::string acctNum);
+std::string reset();
+bool startAudit(const std::string& path);
+void stopAudit();
+extern bool hotAccountStriping;
+
+/**
+ * Generates account indexes with a Zipfian distribution.  Index 0 is the
+ * hottest account.
+ */
+class ZipfGen {
+public:
+    ZipfGen(int numAccts, double theta) : cdf(numAccts) {
+        double sum = 0;
+        for (int i = 0; (i < numAccts); i++) {
+            sum += 1.0 / std::pow(i + 1, theta);
+            cdf[i] = sum;
+        }
+        for (auto& c : cdf) { c /= sum; }
+    }
+
+    int operator()(std::mt19937& rng) const {
+        const double u = std::uniform_real_distribution<double>()(rng);
+        const auto pos = std::lower_bound(cdf.begin(), cdf.end(), u);
+        return std::min<int>(pos - cdf.begin(), cdf.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+/**
+ * Helper method to get the balance reported by status as a double.
+ */
+double getBalance(const std::string& acct) {
+    const std::string msg = status(acct);
+    return std::stod(msg.substr(msg.find('$') + 1));
+}
+
+/**
+ * Run one trial and return the throughput in millions of credits/sec.
+ */
+double runTrial(const std::vector<std::string>& accts, const ZipfGen& zipf,
+                const int numThreads, const int opsPerThread) {
+    reset();
+    for (const auto& acct : accts) { createAcct(acct); }
+    // Pick the accounts up front so only the credits are timed
+    std::vector<std::vector<int>> picks(numThreads);
+    for (int thr = 0; (thr < numThreads); thr++) {
+        std::mt19937 rng(thr + 1);
+        for (int op = 0; (op < opsPerThread); op++) {
+            picks[thr].push_back(zipf(rng));
+        }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> thrList;
+    for (int thr = 0; (thr < numThreads); thr++) {
+        thrList.push_back(std::thread([&accts, &picks, thr] {
+            for (int idx : picks[thr]) { credit(accts[idx], 1); }
+        }));
+    }
+    for (auto& t : thrList) { t.join(); }
+    const std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    // Ensure no credit got lost along the way
+    double total = 0;
+    for (const auto& acct : accts) { total += getBalance(acct); }
+    if (total != 1.0 * numThreads * opsPerThread) {
+        std::cerr << "Balances add up to " << total << " but expected "
+                  << 1.0 * numThreads * opsPerThread << std::endl;
+    }
+    return numThreads * opsPerThread / secs.count() / 1e6;
+}
+
+/**
+ * Helper method to get the CPU time used by the calling thread in
+ * nanoseconds (so the audit writer thread is not counted).
+ */
+double threadCpuNs() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * Time credits to one account from one thread, in nanoseconds per credit.
+ * There are fewer credits than fit in the audit ring, so none are dropped.
+ */
+double timeCredits(const int numOps) {
+    reset();
+    createAcct("0x0");
+    const double start = threadCpuNs();
+    for (int op = 0; (op < numOps); op++) { credit("0x0", 1); }
+    return (threadCpuNs() - start) / numOps;
+}
+
+/**
+ * Runs the benchmark for 1, 2, 4, ... up to maxThreads threads.
+ */
+int runZipfBench(int argc, char** argv) {
+    const int maxThreads = (argc > 1 ? std::stoi(argv[1]) :
+                            std::thread::hardware_concurrency());
+    const int opsPerThread = (argc > 2 ? std::stoi(argv[2]) : 1000000);
+    const int numAccts = (argc > 3 ? std::stoi(argv[3]) : 1000);
+    const double theta = (argc > 4 ? std::stod(argv[4]) : 0.99);
+    std::vector<std::string> accts;
+    for (int i = 0; (i < numAccts); i++) {
+        accts.push_back("0x" + std::to_string(i));
+    }
+    const ZipfGen zipf(numAccts, theta);
+    std::cout << "Zipfian credits: " << numAccts << " accounts, theta "
+              << theta << ", " << opsPerThread << " credits/thread\n"
+              << "threads  single(Mops/s)  striped(Mops/s)\n";
+    for (int thrs = 1; (thrs <= maxThreads); thrs *= 2) {
+        hotAccountStriping = false;
+        const double single = runTrial(accts, zipf, thrs, opsPerThread);
+        hotAccountStriping = true;
+        const double striped = runTrial(accts, zipf, thrs, opsPerThread);
+        std::cout << std::setw(7) << thrs << std::fixed << std::setprecision(2)
+                  << std::setw(16) << single << std::setw(17) << striped
+                  << std::endl;
+    }
+    const int AuditOps = 50000;
+    const double plain = timeCredits(AuditOps);
+    if (!startAudit("bank_bench_audit.log")) {
+        std::cerr << "Unable to open bank_bench_audit.log\n";
+        return 1;
+    }
+    const double audited = timeCredits(AuditOps);
+    std::cout << "Credit: " << plain << " ns, audited: " << audited
+              << " ns (audit cost " << audited - plain << " ns)\n";
+    // Write out every audit record before the ring goes away
+    stopAudit();
+    return 0;
+}
+
+// End of source code
@@ -4,7 +4,10 @@
  * A multithreaded client to test operations of a Banking web-server.
  *
  * This program generates concurrent requests to the Banking
- * web-server to test its operations.
+ * web-server to test its operations.  Requests are sent as HTTP, or over
+ * the compact binary protocol (bank_proto.h) when "binary" is given after
+ * the port.  Throughput and mean latency are reported at the end so the
+ * two can be compared.
  */
 
 #include <boost/asio.hpp>
@@ -18,6 +21,10 @@
 #include <utility>
 #include <vector>
 #include <chrono>
+#include <atomic>
+#include <unordered_map>
+#include <cmath>
+#include "bank_proto.h"
 
 // Setup a server socket to accept connections on the socket
 using namespace boost::asio;
@@ -29,6 +36,26 @@ using TcpStreamPtr = std::shared_ptr<tcp::iostream>;
 // A list of request & expected response pairs of strings
 using ReqRespList = std::vector<std::pair<std::string, std::string>>;
 
+// Send requests over the binary protocol instead of HTTP
+bool binaryMode = false;
+// Most binary requests in flight on a connection.  Past this the client
+// reads responses before sending more, so neither side can fill up the
+// socket buffers while the other one is not reading.
+const size_t MaxInFlight = 1024;
+// Statistics on requests for the summary at the end
+std::atomic<long> reqCount{0};
+std::atomic<long> latencyUsec{0};
+
+/**
+ * Helper method to record the latency of a request sent at 'start'.
+ */
+void recordLatency(std::chrono::steady_clock::time_point start) {
+    using namespace std::chrono;
+    reqCount++;
+    latencyUsec += duration_cast<microseconds>(steady_clock::now() -
+                                               start).count();
+}
+
 /**
  * Helper method to extract the response message from the HTTP
  * response.
@@ -58,6 +85,7 @@ std::string getResponse(std::istream& is) {
 */
 void processRequest(std::string port, const std::string& request,
                     const std::string& expectedResult) {
+    const auto start = std::chrono::steady_clock::now();
     ip::tcp::iostream server("localhost", port);
     if (!server) {
         // Can't connect to server
@@ -74,6 +102,7 @@ void processRequest(std::string port, const std::string& request,
         std::cerr << "Invalid header line from server!\n";
     } else {
         const std::string msg = getResponse(server);
+        recordLatency(start);
         // Read rest of the message from the client.
         if (msg != expectedResult) {
             std::cerr << "Invalid msg from server. Expected: '"
@@ -83,11 +112,143 @@ void processRequest(std::string port, const std::string& request,
     }
 }
 
+/**
+ * Helper method to convert a request like "trans=credit&acct=1&amount=5"
+ * into a binary protocol request.
+ */
+BinRequest toBinRequest(uint64_t reqId, const std::string& request) {
+    // An unknown transaction is sent as opcode 0 (a bad request)
+    BinRequest req{reqId, static_cast<BinOp>(0), 0, ""};
+    std::istringstream params(request);
+    for (std::string param; std::getline(params, param, '&');) {
+        const size_t eq  = param.find('=');
+        const std::string key = param.substr(0, eq);
+        const std::string val = param.substr(eq + 1);
+        if (key == "acct") {
+            req.acct = val;
+        } else if (key == "amount") {
+            req.amount = std::llround(std::stod(val) * 100);
+        } else if (key == "trans") {
+            req.op = (val == "reset"  ? BinOp::Reset  :
+                      val == "create" ? BinOp::Create :
+                      val == "status" ? BinOp::Status :
+                      val == "credit" ? BinOp::Credit :
+                      val == "debit"  ? BinOp::Debit  : static_cast<BinOp>(0));
+        }
+    }
+    return req;
+}
+
+/**
+ * Helper method to render a binary protocol response as the text the HTTP
+ * interface would have sent, so the same expected results can be used.
+ */
+std::string toText(const BinRequest& req, const BinResponse& resp) {
+    std::ostringstream os;
+    switch (resp.status) {
+        case BinStatus::Ok:
+            if (req.op == BinOp::Reset) {
+                os << "All accounts reset";
+            } else if (req.op == BinOp::Status) {
+                os << "Account " << req.acct << ": $" << std::fixed
+                   << std::setprecision(2) << resp.balance / 100.0;
+            } else {
+                os << "Account balance updated";
+            }
+            break;
+        case BinStatus::Created:  os << "Account " << req.acct << " created";
+            break;
+        case BinStatus::Exists:
+            os << "Account " << req.acct << " already exists";
+            break;
+        case BinStatus::NotFound: os << "Account not found";
+            break;
+        case BinStatus::ReadOnly:
+            os << "Read-only replica; send writes to the primary";
+            break;
+        default: os << "Bad request";
+    }
+    return os.str();
+}
+
+/**
+ * Helper method to pipeline the requests at index 'first', 'first + step',
+ * ... over one binary protocol connection and check the responses (which
+ * are matched up using their request ID).  At most MaxInFlight requests
+ * are outstanding; once that many are out, half of them are read back
+ * before more are sent.
+ */
+void processBinRequests(const std::string& port,
+                        const ReqRespList& reqRespList,
+                        const size_t first, const size_t step) {
+    ip::tcp::iostream server("localhost", port);
+    if (!server) {
+        std::cout << "Error connecting to server on port " << port << std::endl;
+        return;
+    }
+    // Batches are flushed by hand, so Nagle would only delay them
+    boost::system::error_code ec;
+    server.socket().set_option(tcp::no_delay(true), ec);
+    // Requests sent but not answered yet, with when each one went out
+    std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> sent;
+    size_t next = first;
+    while (server && (next < reqRespList.size() || !sent.empty())) {
+        for (; (next < reqRespList.size()) && (sent.size() < MaxInFlight);
+             next += step) {
+            sent[next] = std::chrono::steady_clock::now();
+            writeRequest(server, toBinRequest(next, reqRespList[next].first));
+        }
+        server.flush();
+        // Check responses in whatever order they come back (all of them
+        // once there is nothing left to send)
+        const size_t keep = (next < reqRespList.size() ? MaxInFlight / 2 : 0);
+        for (BinResponse resp; sent.size() > keep &&
+                 readResponse(server, resp);) {
+            if (sent.find(resp.reqId) == sent.end()) {
+                std::cerr << "Unexpected request ID from server!\n";
+                return;
+            }
+            recordLatency(sent[resp.reqId]);
+            sent.erase(resp.reqId);
+            const auto& reqResp = reqRespList[resp.reqId];
+            const std::string msg =
+                toText(toBinRequest(resp.reqId, reqResp.first), resp);
+            if (msg != reqResp.second) {
+                std::cerr << "Invalid msg from server. Expected: '"
+                          << reqResp.second << "' but got '"
+                          << msg << "'\n";
+            }
+        }
+    }
+    if (!sent.empty()) {
+        std::cerr << "Server closed connection with requests pending!\n";
+    }
+}
+
+/**
+ * Run requests over the binary protocol using 1 or more threads, each
+ * with one pipelined connection.
+ */
+void runBinRequests(const std::string& port, const ReqRespList& reqRespList,
+                    const int numThreads) {
+    std::vector<std::thread> thrList;
+    for (int thr = 0; (thr < numThreads); thr++) {
+        thrList.push_back(std::thread(processBinRequests, port,
+                                      std::cref(reqRespList), thr,
+                                      numThreads));
+    }
+    for (auto& t : thrList) { t.join(); }
+}
+
 /**
  * Run requests using 1 or more threads.
  */
 void runRequests(const std::string& port, const ReqRespList& reqRespList,
                  const int numThreads) {
+    if (binaryMode) {
+        runBinRequests(port, reqRespList, numThreads);
+        return;
+    }
     // Submit requests to the server in batches of size 'numThreads'
     for (size_t stReq = 0; (stReq < reqRespList.size()); stReq += numThreads) {
         // Sumit a batch of requests to the server.
@@ -114,6 +275,7 @@ void processInputCmds(std::istream& input, const std::string& port) {
     std::string req, resp;   // request, response.
     ReqRespList testData;    // List of operations for testing.
     int block = 0;           // Just block number for progress reporting
+    const auto start = std::chrono::steady_clock::now();
     // Read line-by-line of input and process it.
     while (input >> std::quoted(req)) {
         if (req == "run") {
@@ -132,6 +294,12 @@ void processInputCmds(std::istream& input, const std::string& port) {
         }
     }    
     std::cout << "Testing completed.\n";
+    // Report throughput and latency
+    const std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    std::cout << reqCount << " requests in " << secs.count() << " sec ("
+              << reqCount / secs.count() << " req/sec, mean latency "
+              << latencyUsec / std::max(1L, reqCount.load()) << " usec)\n";
 }
 
 #ifndef TEST_CLIENT
@@ -143,10 +311,11 @@ void checkRunClient(const std::string& port)  {}
  * arguments are specified and then 
  */
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Specify InputFile and ServerPort\n";
+    if ((argc != 3) && (argc != 4)) {
+        std::cerr << "Specify InputFile and ServerPort [binary]\n";
         return 1;
     }
+    binaryMode = (argc == 4) && (std::string(argv[3]) == "binary");
     // Open the input file to be used for testing.
     std::ifstream input(argv[1]);
     if (!input.good()) {
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2019 overbejt@miamioh.edu
+ *
+ * File: bank_proto.h
+ * Author: Josh Overbeck
+ * Description: The compact binary protocol spoken by the bank server.
+ *
+ * Every message is a frame starting with its length (not counting the
+ * length itself).  All integers are big-endian.
+ *
+ *   Request:  u32 len | u64 reqId | u8 op | i64 amount | u16 acctLen | acct
+ *   Response: u32 len | u64 reqId | u8 status | i64 balance
+ *
+ * Amounts and balances are in cents.  Responses carry the request ID so a
+ * client can pipeline requests and match responses in any order.
+ *
+ */
+
+#ifndef BANK_PROTO_H
+#define BANK_PROTO_H
+
+#include <cstdint>
+#include <string>
+#include <istream>
+#include <ostream>
+
+// The transactions that can be requested
+enum class BinOp : uint8_t { Reset = 1, Create, Status, Credit, Debit };
+
+// The outcome of a transaction
+enum class BinStatus : uint8_t {
+    Ok = 0, Created, Exists, NotFound, ReadOnly, BadRequest
+};
+
+// Bytes in a request frame (after the length) not counting the account
+const uint32_t BinRequestFixedLen = 8 + 1 + 8 + 2;
+// Bytes in a response frame after the length
+const uint32_t BinResponseLen = 8 + 1 + 8;
+
+/**
+ * A request decoded from (or to be encoded into) a frame.
+ */
+struct BinRequest {
+    uint64_t reqId;
+    BinOp op;
+    int64_t amount;
+    std::string acct;
+};
+
+/**
+ * A response decoded from (or to be encoded into) a frame.
+ */
+struct BinResponse {
+    uint64_t reqId;
+    BinStatus status;
+    int64_t balance;
+};
+
+/**
+ * Helper method to write the low 'bytes' bytes of a value, big-endian.
+ */
+inline void putInt(std::ostream& os, uint64_t val, int bytes) {
+    for (int shift = (bytes - 1) * 8; (shift >= 0); shift -= 8) {
+        os.put(static_cast<char>((val >> shift) & 0xff));
+    }
+}
+
+/**
+ * Helper method to read a big-endian value of 'bytes' bytes.
+ */
+inline uint64_t getInt(std::istream& is, int bytes) {
+    uint64_t val = 0;
+    for (int i = 0; (i < bytes); i++) {
+        val = (val << 8) | static_cast<uint8_t>(is.get());
+    }
+    return val;
+}
+
+/**
+ * Write a request frame.
+ */
+inline void writeRequest(std::ostream& os, const BinRequest& req) {
+    putInt(os, BinRequestFixedLen + req.acct.size(), 4);
+    putInt(os, req.reqId, 8);
+    putInt(os, static_cast<uint8_t>(req.op), 1);
+    putInt(os, req.amount, 8);
+    putInt(os, req.acct.size(), 2);
+    os.write(req.acct.data(), req.acct.size());
+}
+
+/**
+ * Read a request frame.
+ *
+ * @return false on end of stream or a malformed frame.
+ */
+inline bool readRequest(std::istream& is, BinRequest& req) {
+    const uint32_t len = getInt(is, 4);
+    if (!is || (len < BinRequestFixedLen) || (len > BinRequestFixedLen +
+            0xffff)) {
+        return false;
+    }
+    req.reqId  = getInt(is, 8);
+    req.op     = static_cast<BinOp>(getInt(is, 1));
+    req.amount = static_cast<int64_t>(getInt(is, 8));
+    const uint32_t acctLen = getInt(is, 2);
+    if (acctLen != len - BinRequestFixedLen) {
+        return false;
+    }
+    req.acct.resize(acctLen);
+    is.read(&req.acct[0], acctLen);
+    return static_cast<bool>(is);
+}
+
+/**
+ * Write a response frame.
+ */
+inline void writeResponse(std::ostream& os, const BinResponse& resp) {
+    putInt(os, BinResponseLen, 4);
+    putInt(os, resp.reqId, 8);
+    putInt(os, static_cast<uint8_t>(resp.status), 1);
+    putInt(os, resp.balance, 8);
+}
+
+/**
+ * Read a response frame.
+ *
+ * @return false on end of stream or a malformed frame.
+ */
+inline bool readResponse(std::istream& is, BinResponse& resp) {
+    if (getInt(is, 4) != BinResponseLen || !is) {
+        return false;
+    }
+    resp.reqId   = getInt(is, 8);
+    resp.status  = static_cast<BinStatus>(getInt(is, 1));
+    resp.balance = static_cast<int64_t>(getInt(is, 8));
+    return static_cast<bool>(is);
+}
+
+#endif  // BANK_PROTO_H
+
+// End of source code
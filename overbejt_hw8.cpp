@@ -9,6 +9,28 @@
  * This multi threaded web-server performs simple bank transactions on
  * accounts.  Accounts are maintained in an unordered_map.  
  * 
+ * A handful of accounts can receive most of the credits.  Such hot accounts
+ * are detected by contention on their balance and switch to striped
+ * sub-balances (one per group of threads) that are summed on status.  They
+ * fold back into a single balance once the contention goes away.
+ * 
+ * To scale reads, a primary can stream its committed transactions over a
+ * loopback socket to follower processes of this same program.  Followers
+ * apply them in order, serve status with their lag reported in a header,
+ * and reject writes.
+ * 
+ *   Primary:  overbejt_hw8 <port> primary <replPort>
+ *   Follower: overbejt_hw8 <port> follow <replPort>
+ * 
+ * For service-to-service traffic a second port can speak the compact
+ * binary protocol in bank_proto.h ("binary <binPort>" on the command line).
+ * Both front ends share the same account operations.
+ * 
+ * With "audit <file>" every create/credit/debit/reset is pushed as a fixed
+ * size record into a lock-free ring and written out by a separate thread to
+ * rotating log files.  "audit-full block|drop" picks what happens when the
+ * ring is full and "audit-rotate <bytes>" sets the size of each file.
+ * 
  */
 
 // All the necessary includes are present
@@ -21,17 +43,232 @@
 #include <unordered_map>
 #include <mutex>
 #include <iomanip>
+#include <atomic>
+#include <shared_mutex>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <ctime>
+#include <cstdlib>
+#include <sys/socket.h>
+#include "bank_proto.h"
+#include "audit_ring.h"
 
 // Setup a server socket to accept connections on the socket
 using namespace boost::asio;
 using namespace boost::asio::ip;
+
+// Number of sub-balances a hot account is spread across
+const int StripeCount = 16;
+// Size of a cache line
+const int CacheLine = 64;
+// Collisions on a single balance within one window that make it hot
+const int HotThreshold = 32;
+// Length of the window collisions are counted in (nanoseconds)
+const long long CollisionWindow = 10000000;
+// How long a hot account stays striped before its contention is probed
+const long long HotHold = 100000000;
+// Updates to one stripe between checks of the hold time
+const int CoolCheck = 64;
+// How often hot accounts are checked for cooling down even if idle
+const std::chrono::nanoseconds SweepPeriod(CollisionWindow);
+// Switch for hot account striping (turned off to compare in the benchmark)
+bool hotAccountStriping = true;
+
+/**
+ * A sub-balance of a hot account.  Cells are laid out on cache line
+ * boundaries, so updating one does not slow down threads working on its
+ * neighbours.
+ */
+struct alignas(CacheLine) Cell {
+    std::atomic<double> value{0.0};
+    std::atomic<long> ops{0};
+};
+
+/**
+ * The stripes of a hot account.  They are only allocated while the account
+ * is hot.  The build is C++14, where new ignores alignas, so the cells are
+ * aligned by hand inside a slightly larger buffer.
+ */
+class Stripes {
+public:
+    Stripes();
+    Cell& operator[](int idx) { return cells[idx]; }
+    double sum();
+    double drain();
+    // Bank slots known to hold no update that could still use these stripes
+    int graced = 0;
+
+private:
+    std::unique_ptr<char[]> raw;
+    Cell* cells;
+};
+
+/**
+ * A bank account.  The balance normally lives in one atomic double.  When
+ * updates collide on it often enough within a window the account goes hot
+ * and every thread adds into its own stripe instead.  After a while a hot
+ * account probes its contention by sending updates to the base balance
+ * again for one window; if they no longer collide the stripes are folded
+ * back and freed.  The balance is always base plus any stripes.  Hot
+ * accounts are also swept periodically, so they cool down (and free their
+ * stripes) even when their updates stop.
+ */
+class Account {
+public:
+    ~Account();
+    double update(double amt);
+    double balance();
+    void sweep();
+    bool isCold();
+    // In the list of hot accounts (changed with hotMutex held)
+    std::atomic<bool> listed{false};
+
+private:
+    void listHot();
+    void noteCollisions(int retries);
+    void promote(long long now);
+    void startProbe();
+    void endProbe();
+    void reclaim();
+    // The balance while cold (and most of it while hot)
+    std::atomic<double> base{0.0};
+    // Stripes while hot (null while cold)
+    std::atomic<Stripes*> stripes{nullptr};
+    // Hot, but sending updates to base to measure contention
+    std::atomic<bool> probing{false};
+    // Stripes taken out of use, freed once no update can still be using them
+    std::atomic<Stripes*> retired{nullptr};
+    // Collisions on base in the window starting at windowStart
+    std::atomic<int> collisions{0};
+    std::atomic<long long> windowStart{0};
+    // When a hot account probes next, or when a probe ends
+    std::atomic<long long> deadline{0};
+    // Serializes promoting, cooling, and summing the balance
+    std::mutex foldLock;
+};
+
+/**
+ * A reader/writer lock made of padded mutexes.  Transactions only lock the
+ * slot of their own thread, so they do not all fight over one lock word.
+ * Creating accounts and resetting the bank lock every slot.
+ */
+class BankLock {
+public:
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+    bool tryLockSlot(int idx);
+    void unlockSlot(int idx);
+    void graceSlots(int& graced);
+
+private:
+    // The bank lock is a global, so alignas is honored here
+    struct alignas(CacheLine) Slot {
+        std::mutex mutex;
+    };
+    Slot slots[StripeCount];
+};
+
+// Accounts with stripes (in use or retired) for the sweeper to look at.
+// Declared ahead of the bank, which uses them when its accounts go away.
+std::vector<Account*> hotAccts;
+std::mutex hotMutex;
+// Thread sweeping hot accounts (started by the first promotion)
+std::thread hotSweeper;
+std::atomic<bool> hotSweepStop{false};
+
 // Create a bank to make reading easier
-std::unordered_map<std::string, double> bank;
+std::unordered_map<std::string, Account> bank;
+// Guards the structure of the bank (not the balances)
+BankLock bankLock;
 // Using smart pointer
 using TcpStreamPtr = std::shared_ptr<tcp::iostream>;
 
+// Role of this process in replication (set from the command line)
+enum class Role { Standalone, Primary, Follower };
+Role role = Role::Standalone;
+// How often an idle primary tells followers they are up to date
+const std::chrono::milliseconds HeartbeatPeriod(100);
+// Records a follower may fall behind (past its snapshot) before it is cut
+// off; it then reconnects and starts over from a fresh snapshot
+const size_t MaxPending = 100000;
+// How often shippers collect the records queued in the bank slots
+const std::chrono::milliseconds ShipPeriod(1);
+// Records queued in one bank slot before the transaction that queues the
+// last one moves them to the followers itself
+const size_t SlotBacklog = 1024;
+
+/**
+ * A committed transaction on its way to the followers.  It is only turned
+ * into text by the thread shipping it.
+ */
+struct ReplEntry {
+    long long primaryMs;
+    const char* trans;
+    std::string acct;
+    double amt;
+};
+
+/**
+ * The records queued by the transactions of one bank slot.  Each queue is
+ * guarded by the bank slot with the same index, which transactions hold
+ * anyway, so queuing a record takes no lock of its own.
+ */
+struct alignas(CacheLine) ReplSlot {
+    std::vector<ReplEntry> queue;
+};
+ReplSlot replSlots[StripeCount];
+
+/**
+ * A follower connected to the primary.  Records collected from the bank
+ * slots are handed to it and a thread of its own ships them.
+ */
+struct Follower {
+    std::deque<ReplEntry> pending;
+    // Most records that may be pending
+    size_t maxPending = MaxPending;
+    // Set once the follower fell too far behind
+    bool dropped = false;
+    // Socket to the follower (to cut it off)
+    int socket = -1;
+};
+using FollowerPtr = std::shared_ptr<Follower>;
+// The followers being streamed to (guarded by replMutex)
+std::vector<FollowerPtr> followers;
+std::mutex replMutex;
+// Lets transactions skip logging while nobody is following
+std::atomic<int> followerCount{0};
+// Primary time of the latest record applied by this follower
+std::atomic<long long> lastPrimaryMs{0};
+
+// Audit records on their way to the writer (null when not auditing)
+std::unique_ptr<AuditRing> auditRing;
+// Wait for room when the ring is full instead of dropping the record
+bool auditBlock = false;
+// Records dropped because the ring was full
+std::atomic<long> auditDropped{0};
+// Thread writing out the ring, and the flag telling it to finish up
+std::thread auditWriter;
+std::atomic<bool> auditStop{false};
+// Size at which the audit file is rotated, and rotated files kept
+long auditRotateBytes = 64 << 20;
+const int AuditKeep = 5;
+// Client of the connection served by this thread (for audit records)
+thread_local uint32_t clientAddr = 0;
+thread_local uint16_t clientPort = 0;
+
 
 // Forward declaration for method defined further below
+bool openAcct(const std::string& acctNum);
+bool updateAcct(const std::string& acctNum, AuditOp op, double amt);
+bool acctBalance(const std::string& acctNum, double& balance);
 std::string createAcct(std::string acctNum);
 std::string credit(std::string acctNum, double ammount);
 std::string debit(std::string acctNum, double ammount);
@@ -44,6 +281,488 @@ void splitInput(std::string& line);
 std::string status(std::string acctNum);
 void response(std::ostream& os, std::string& content);
 std::string url_decode(std::string);
+int threadStripe();
+long long steadyNs();
+void runHotSweep();
+void startHotSweep();
+void stopHotSweep();
+double atomicAdd(std::atomic<double>& value, double amt, int& retries);
+void audit(AuditOp op, const std::string& acctNum = "", double amt = 0,
+        double balance = 0);
+void setClient(basic_socket<tcp>& socket);
+void stopAudit();
+long long nowMs();
+ReplEntry makeEntry(const char* trans, const std::string& acct = "-",
+        double amt = 0);
+void writeRecord(std::ostream& os, const ReplEntry& entry);
+void logTrans(const char* trans, const std::string& acct, double amt);
+void logExclusive(const char* trans, const std::string& acct = "-");
+void deliver(std::vector<ReplEntry>& entries);
+void deliverQueued();
+void collectRepl();
+
+/**
+ * This method will give the stripe used by the calling thread.  Threads are
+ * handed out stripes round-robin the first time they ask.
+ * 
+ * @return The index of the stripe for this thread.
+ */
+int threadStripe() {
+    static std::atomic<int> nextStripe{0};
+    static thread_local const int stripe = nextStripe++ % StripeCount;
+    return stripe;
+}  // End of the 'threadStripe' method
+
+/**
+ * This method will add an amount to an atomic double.
+ * 
+ * @param value The double to be updated.
+ * @param amt The amount to add to it.
+ * @param retries Set to the number of times the update collided with
+ * another thread.
+ * @return The new value of the double.
+ */
+double atomicAdd(std::atomic<double>& value, double amt, int& retries) {
+    retries = 0;
+    double curr = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(curr, curr + amt,
+            std::memory_order_relaxed)) {
+        retries++;
+    }
+    return curr + amt;
+}  // End of the 'atomicAdd' method
+
+/**
+ * This method will give a monotonic time for measuring contention.
+ * 
+ * @return Nanoseconds on the steady clock.
+ */
+long long steadyNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+}  // End of the 'steadyNs' method
+
+/**
+ * This constructor will allocate zeroed stripes on cache line boundaries.
+ */
+Stripes::Stripes() : raw(new char[(StripeCount + 1) * CacheLine]) {
+    void* buf = raw.get();
+    size_t space = (StripeCount + 1) * CacheLine;
+    cells = static_cast<Cell*>(std::align(CacheLine,
+            StripeCount * sizeof(Cell), buf, space));
+    for (int i = 0; i < StripeCount; i++) {
+        new (&cells[i]) Cell();
+    }
+}  // End of the 'Stripes' constructor
+
+/**
+ * This method will add up the stripes.
+ * 
+ * @return The sum of all the stripes.
+ */
+double Stripes::sum() {
+    double total = 0;
+    for (int i = 0; i < StripeCount; i++) {
+        total += cells[i].value.load();
+    }
+    return total;
+}  // End of the 'sum' method
+
+/**
+ * This method will empty the stripes.
+ * 
+ * @return The sum of what was taken out of the stripes.
+ */
+double Stripes::drain() {
+    double total = 0;
+    for (int i = 0; i < StripeCount; i++) {
+        total += cells[i].value.exchange(0.0);
+    }
+    return total;
+}  // End of the 'drain' method
+
+/**
+ * The destructor frees the stripes of the account, if any, and takes it
+ * off the list of hot accounts.  Accounts in the bank are only destroyed
+ * with the whole bank locked.
+ */
+Account::~Account() {
+    if (listed.load()) {
+        std::lock_guard<std::mutex> guard(hotMutex);
+        auto pos = std::find(hotAccts.begin(), hotAccts.end(), this);
+        if (pos != hotAccts.end()) {
+            hotAccts.erase(pos);
+        }
+    }
+    delete stripes.load();
+    delete retired.load();
+}  // End of the 'Account' destructor
+
+/**
+ * This method will add an amount to the account.  It must be called with
+ * the calling thread's bank slot locked.
+ * 
+ * @param amt The amount to add (negative for a debit).
+ * @return The balance right after the update.  It is NAN whenever stripes
+ * exist (hot, probing, or retired but not yet freed), since part of the
+ * balance may then be in them and there is no single balance to read
+ * cheaply.
+ */
+double Account::update(double amt) {
+    int retries;
+    Stripes* hot = stripes.load();
+    if (hot != nullptr && !probing.load(std::memory_order_relaxed)) {
+        Cell& cell = (*hot)[threadStripe()];
+        atomicAdd(cell.value, amt, retries);
+        if (cell.ops.fetch_add(1, std::memory_order_relaxed) % CoolCheck ==
+                CoolCheck - 1 && steadyNs() >= deadline.load()) {
+            startProbe();
+        }
+        return NAN;
+    }
+    const double balance = atomicAdd(base, amt, retries);
+    if (retries > 0) {
+        noteCollisions(retries);
+    }
+    if (hot != nullptr) {
+        if (steadyNs() >= deadline.load()) {
+            endProbe();
+        }
+        return NAN;
+    }
+    if (retired.load() != nullptr) {
+        reclaim();
+        return NAN;
+    }
+    // Stripes published since the first check may already hold updates
+    return stripes.load() == nullptr ? balance : NAN;
+}  // End of the 'update' method
+
+/**
+ * This method will count collisions on the base balance.  The count starts
+ * over every window, so only a high rate of collisions makes an account
+ * hot (or keeps a probing account hot).
+ * 
+ * @param retries The collisions seen by one update.
+ */
+void Account::noteCollisions(int retries) {
+    const long long now = steadyNs();
+    if (now - windowStart.load(std::memory_order_relaxed) > CollisionWindow) {
+        windowStart.store(now, std::memory_order_relaxed);
+        collisions.store(retries, std::memory_order_relaxed);
+    } else if (collisions.fetch_add(retries, std::memory_order_relaxed) +
+            retries >= HotThreshold && hotAccountStriping) {
+        promote(now);
+    }
+}  // End of the 'noteCollisions' method
+
+/**
+ * This method will make the account hot (or keep it hot if it was
+ * probing).  Stripes are allocated here, on the first promotion.
+ * 
+ * @param now The current steady time.
+ */
+void Account::promote(long long now) {
+    std::unique_lock<std::mutex> guard(foldLock, std::try_to_lock);
+    if (!guard || retired.load() != nullptr) {
+        return;  // Busy, or the last stripes are not freed yet
+    }
+    deadline.store(now + HotHold);
+    collisions.store(0);
+    probing.store(false);
+    if (stripes.load() == nullptr) {
+        stripes.store(new Stripes());
+        listHot();
+    }
+}  // End of the 'promote' method
+
+/**
+ * This method will add the account to the list of hot accounts (if it is
+ * not on it yet), starting the sweeper the first time.
+ */
+void Account::listHot() {
+    static std::once_flag started;
+    std::call_once(started, startHotSweep);
+    std::lock_guard<std::mutex> guard(hotMutex);
+    if (!listed.load()) {
+        listed.store(true);
+        hotAccts.push_back(this);
+    }
+}  // End of the 'listHot' method
+
+/**
+ * This method will move a hot account along towards cooling down when its
+ * time is up, as an update would: start a probe, end a probe that saw no
+ * collisions, and free retired stripes.  It must be called with the
+ * calling thread's bank slot locked.
+ */
+void Account::sweep() {
+    if (stripes.load() != nullptr && steadyNs() >= deadline.load()) {
+        if (probing.load()) {
+            endProbe();
+        } else {
+            startProbe();
+        }
+    }
+    if (retired.load() != nullptr) {
+        reclaim();
+    }
+}  // End of the 'sweep' method
+
+/**
+ * This method will tell if the account has no stripes at all.
+ * 
+ * @return true if the account is cold.
+ */
+bool Account::isCold() {
+    return stripes.load() == nullptr && retired.load() == nullptr;
+}  // End of the 'isCold' method
+
+/**
+ * This method will start probing a hot account whose hold time is up:
+ * for one window updates go to the base balance so that their collisions
+ * can be counted.
+ */
+void Account::startProbe() {
+    std::unique_lock<std::mutex> guard(foldLock, std::try_to_lock);
+    if (!guard || probing.load() || stripes.load() == nullptr) {
+        return;
+    }
+    const long long now = steadyNs();
+    windowStart.store(now);
+    collisions.store(0);
+    deadline.store(now + CollisionWindow);
+    probing.store(true);
+}  // End of the 'startProbe' method
+
+/**
+ * This method will end a probe that was not cut short by collisions, so
+ * the account has cooled down.  The stripes are folded into the base
+ * balance and retired until no update can still be using them.
+ */
+void Account::endProbe() {
+    std::unique_lock<std::mutex> guard(foldLock, std::try_to_lock);
+    if (!guard || !probing.load()) {
+        return;
+    }
+    Stripes* old = stripes.load();
+    stripes.store(nullptr);
+    probing.store(false);
+    int retries;
+    atomicAdd(base, old->drain(), retries);
+    retired.store(old);
+}  // End of the 'endProbe' method
+
+/**
+ * This method will free retired stripes.  Updates that picked up the
+ * stripes before they were retired hold a bank slot until they are done,
+ * so once every slot has been seen free (or is ours) nobody can be using
+ * them.  Slots that are busy are checked again on a later update.
+ */
+void Account::reclaim() {
+    std::unique_lock<std::mutex> guard(foldLock, std::try_to_lock);
+    Stripes* old = retired.load();
+    if (!guard || old == nullptr) {
+        return;
+    }
+    bankLock.graceSlots(old->graced);
+    if (old->graced != (1 << StripeCount) - 1) {
+        return;
+    }
+    // Fold in whatever late updates added after the stripes were retired
+    int retries;
+    atomicAdd(base, old->drain(), retries);
+    retired.store(nullptr);
+    delete old;
+}  // End of the 'reclaim' method
+
+/**
+ * This method will get the balance of the account.
+ * 
+ * @return The sum of the base balance and any stripes.
+ */
+double Account::balance() {
+    std::lock_guard<std::mutex> guard(foldLock);
+    double total = base.load();
+    Stripes* hot = stripes.load();
+    Stripes* old = retired.load();
+    if (hot != nullptr) {
+        total += hot->sum();
+    }
+    if (old != nullptr) {
+        total += old->sum();
+    }
+    return total;
+}  // End of the 'balance' method
+
+/**
+ * This is a method that will act as the main for the thread sweeping hot
+ * accounts.  Accounts that have cooled down all the way are taken off the
+ * list.  A promotion puts an account back on it.
+ */
+void runHotSweep() {
+    while (!hotSweepStop.load()) {
+        std::this_thread::sleep_for(SweepPeriod);
+        // The bank slot keeps accounts from being destroyed meanwhile
+        std::shared_lock<BankLock> bankGuard(bankLock);
+        std::lock_guard<std::mutex> guard(hotMutex);
+        for (auto acct : hotAccts) {
+            acct->sweep();
+        }
+        hotAccts.erase(std::remove_if(hotAccts.begin(), hotAccts.end(),
+                [](Account* acct) {
+                    const bool cold = acct->isCold();
+                    if (cold) {
+                        acct->listed.store(false);
+                    }
+                    return cold; }), hotAccts.end());
+    }
+}  // End of the 'runHotSweep' method
+
+/**
+ * This method will start the sweeper, and stop it at exit (before the
+ * bank and the list of hot accounts go away).
+ */
+void startHotSweep() {
+    hotSweeper = std::thread(runHotSweep);
+    std::atexit(stopHotSweep);
+}  // End of the 'startHotSweep' method
+
+/**
+ * This method will stop the sweeper.
+ */
+void stopHotSweep() {
+    hotSweepStop.store(true);
+    if (hotSweeper.joinable()) {
+        hotSweeper.join();
+    }
+}  // End of the 'stopHotSweep' method
+
+/**
+ * This method will lock the whole bank (all slots, in order).
+ */
+void BankLock::lock() {
+    for (auto& slot : slots) {
+        slot.mutex.lock();
+    }
+}  // End of the 'lock' method
+
+/**
+ * This method will unlock the whole bank.
+ */
+void BankLock::unlock() {
+    for (auto& slot : slots) {
+        slot.mutex.unlock();
+    }
+}  // End of the 'unlock' method
+
+/**
+ * This method will lock the slot of the calling thread for a transaction.
+ */
+void BankLock::lock_shared() {
+    slots[threadStripe()].mutex.lock();
+}  // End of the 'lock_shared' method
+
+/**
+ * This method will unlock the slot of the calling thread.
+ */
+void BankLock::unlock_shared() {
+    slots[threadStripe()].mutex.unlock();
+}  // End of the 'unlock_shared' method
+
+/**
+ * This method will lock one slot (whoever it belongs to) if it is free.
+ * 
+ * @param idx The index of the slot.
+ * @return true if the slot was locked.
+ */
+bool BankLock::tryLockSlot(int idx) {
+    return slots[idx].mutex.try_lock();
+}  // End of the 'tryLockSlot' method
+
+/**
+ * This method will unlock one slot.
+ * 
+ * @param idx The index of the slot.
+ */
+void BankLock::unlockSlot(int idx) {
+    slots[idx].mutex.unlock();
+}  // End of the 'unlockSlot' method
+
+/**
+ * This method will note which slots have no transaction in them that
+ * started before now.  The calling thread's own slot (which it holds)
+ * counts, as does any slot that can be locked right away.
+ * 
+ * @param graced Bit mask of slots already seen; updated in place.
+ */
+void BankLock::graceSlots(int& graced) {
+    graced |= 1 << threadStripe();
+    for (int i = 0; i < StripeCount; i++) {
+        if (!(graced & (1 << i)) && slots[i].mutex.try_lock()) {
+            slots[i].mutex.unlock();
+            graced |= 1 << i;
+        }
+    }
+}  // End of the 'graceSlots' method
+
+/**
+ * This method will add a new account to the bank.  The account operations
+ * below are shared by the HTTP and binary front ends.
+ * 
+ * @param acctNum The account number for the new account.
+ * @return false if the account already exists.
+ */
+bool openAcct(const std::string& acctNum) {
+    std::lock_guard<BankLock> guard(bankLock);
+    if (!bank.emplace(std::piecewise_construct,
+            std::forward_as_tuple(acctNum), std::forward_as_tuple()).second) {
+        return false;
+    }
+    logExclusive("create", acctNum);
+    audit(AuditOp::Create, acctNum);
+    return true;
+}  // End of the 'openAcct' method
+
+/**
+ * This method will credit or debit an account.  The balance audited is
+ * NAN while the account is hot (see Account::update).
+ * 
+ * @param acctNum The account number.
+ * @param op Either AuditOp::Credit or AuditOp::Debit.
+ * @param amt The amount credited or debited.
+ * @return false if the account was not found.
+ */
+bool updateAcct(const std::string& acctNum, AuditOp op, double amt) {
+    std::shared_lock<BankLock> guard(bankLock);
+    auto acct = bank.find(acctNum);
+    if (acct == bank.end()) {
+        return false;
+    }
+    const bool isDebit = (op == AuditOp::Debit);
+    const double balance = acct->second.update(isDebit ? -amt : amt);
+    logTrans(isDebit ? "debit" : "credit", acctNum, amt);
+    audit(op, acctNum, amt, balance);
+    return true;
+}  // End of the 'updateAcct' method
+
+/**
+ * This method will look up the balance of an account.
+ * 
+ * @param acctNum The account number.
+ * @param balance Set to the balance of the account.
+ * @return false if the account was not found.
+ */
+bool acctBalance(const std::string& acctNum, double& balance) {
+    std::shared_lock<BankLock> guard(bankLock);
+    auto acct = bank.find(acctNum);
+    if (acct == bank.end()) {
+        return false;
+    }
+    balance = acct->second.balance();
+    return true;
+}  // End of the 'acctBalance' method
 
 /**
  * This method will create a new account.
@@ -52,8 +771,7 @@ std::string url_decode(std::string);
  */
 std::string createAcct(std::string acctNum) {
     std::stringstream output;
-    if (bank.find(acctNum) == bank.end()) {
-        bank.insert({acctNum, 0.0});
+    if (openAcct(acctNum)) {
         output << "Account " << acctNum << " created";
     } else {
         output << "Account " << acctNum << " already exists";
@@ -68,15 +786,15 @@ std::string createAcct(std::string acctNum) {
  * @param ammount The amount to be added to the account.
  */
 std::string credit(std::string acctNum, double ammount) {
-    auto acct = bank.find(acctNum);
-    std::stringstream output;
-    if (acct != bank.end()) {
-        acct->second += ammount;
-        output <<  "Account balance updated";
-    } else {
-        output << "Account not found";
+    // A missing amount arrives as NAN and "nan"/"inf" parse as amounts;
+    // none of them may reach a balance (or the followers)
+    if (!std::isfinite(ammount)) {
+        return "Invalid amount";
     }
-    return output.str();
+    if (!updateAcct(acctNum, AuditOp::Credit, ammount)) {
+        return "Account not found";
+    }
+    return "Account balance updated";
 }  // End of the 'credit' method
 
 /**
@@ -86,16 +804,13 @@ std::string credit(std::string acctNum, double ammount) {
  * @param ammount The amount to subtract from the account.
  */
 std::string debit(std::string acctNum, double ammount) {
-    auto acct = bank.find(acctNum);
-    std::stringstream response;
-    std::string output;
-    if (acct != bank.end()) {
-        acct->second -= ammount;
-        response << "Account balance updated";
-    } else {
-        response << "Account not found";
+    if (!std::isfinite(ammount)) {
+        return "Invalid amount";
+    }
+    if (!updateAcct(acctNum, AuditOp::Debit, ammount)) {
+        return "Account not found";
     }
-    return response.str();
+    return "Account balance updated";
 }  // End of the 'debit' method
 
 /**
@@ -138,6 +853,11 @@ void exec(std::ostream& os, std::string& input) {
 void parseNexec(std::ostream& os, std::string cmd, 
         std::string acct, double amt) {
     std::string responseTxt;
+    if (role == Role::Follower && cmd != "status") {
+        responseTxt = "Read-only replica; send writes to the primary";
+        response(os, responseTxt);
+        return;
+    }
     if (cmd == "reset") {
         responseTxt = reset();
     }
@@ -162,7 +882,10 @@ void parseNexec(std::ostream& os, std::string cmd,
  * This is the method that will reset the bank.  
  */
 std::string reset() {
+    std::lock_guard<BankLock> guard(bankLock);
     bank.clear();
+    logExclusive("reset");
+    audit(AuditOp::Reset);
     return "All accounts reset";
 }  // End of the 'reset' method
 
@@ -175,10 +898,10 @@ std::string reset() {
  */
 std::string status(std::string acctNum) {
     std::stringstream ss;
-    auto acct = bank.find(acctNum);
-    if (acct != bank.end()) {
+    double balance;
+    if (acctBalance(acctNum, balance)) {
         ss << "Account " << acctNum << ": $";       
-        ss << std::fixed << std::setprecision(2) << acct->second;    
+        ss << std::fixed << std::setprecision(2) << balance;
     } else {
         ss << "Account not found";
     }
@@ -207,7 +930,9 @@ void splitInput(std::string& line) {
  */
 void serveClient(std::istream& is, std::ostream& os) {
      // 1.) Make sure Input starts with "GET /TransactionInfo"
-    for (std::string line; getline(is, line);) {
+    // The blank line at the end of the headers ends the request
+    for (std::string line; getline(is, line) && line != "\r" && 
+            !line.empty();) {
         if (line.find("GET") != std::string::npos) {
             line = line.erase(0, 5);
             line = line.erase(line.size() - 10);
@@ -232,6 +957,10 @@ void response(std::ostream& os, std::string& content) {
     os << "HTTP/1.1 200 OK\r\n";
     os << "Server: BankServer\r\n";
     os << "Content-Length: " << content.size() << "\r\n";
+    if (role == Role::Follower) {
+        // How far behind the primary this answer may be
+        os << "X-Replica-Lag-Ms: " << nowMs() - lastPrimaryMs << "\r\n";
+    }
     os << "Connection: Close\r\n";
     os << "Content-Type: text/plain\r\n\r\n";
     os << content;
@@ -243,9 +972,689 @@ void response(std::ostream& os, std::string& content) {
  * @param stream The iostream associated to the client connection
  */
 void thrdInit(TcpStreamPtr stream) {
+    setClient(stream->socket());
     serveClient(*stream, *stream);
 }  // End of the 'thrdinit' method
 
+/**
+ * This method will give the wall clock time.  Primary and followers run on
+ * the same box, so their times can be compared.
+ * 
+ * @return Milliseconds since the epoch.
+ */
+long long nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(
+            system_clock::now().time_since_epoch()).count();
+}  // End of the 'nowMs' method
+
+/**
+ * This method will make a replication record stamped with the current
+ * time.
+ * 
+ * @param trans The transaction (or "beat" for a heartbeat).
+ * @param acct The account number ("-" if there is none).
+ * @param amt The amount (0 if there is none).
+ * @return The record.
+ */
+ReplEntry makeEntry(const char* trans, const std::string& acct,
+        double amt) {
+    return ReplEntry{nowMs(), trans, acct, amt};
+}  // End of the 'makeEntry' method
+
+/**
+ * This method will write a replication record.  Records are one line each:
+ * "<primaryMs> <trans> <acct> <amount>".
+ * 
+ * @param os The stream to the follower.
+ * @param entry The record to write.
+ */
+void writeRecord(std::ostream& os, const ReplEntry& entry) {
+    os << entry.primaryMs << ' ' << entry.trans << ' ' << entry.acct << ' '
+       << std::setprecision(17) << entry.amt << '\n';
+}  // End of the 'writeRecord' method
+
+/**
+ * This method will hand records to every follower.  It is called with
+ * replMutex held.  A follower that would fall more than its maxPending
+ * records behind is disconnected instead.
+ * 
+ * @param entries The records (emptied).
+ */
+void deliver(std::vector<ReplEntry>& entries) {
+    for (auto& follower : followers) {
+        if (follower->dropped || entries.empty()) {
+            continue;
+        }
+        if (follower->pending.size() + entries.size() >
+                follower->maxPending) {
+            // Too far behind: reset the connection (what is queued for it
+            // is of no use) so it resyncs, which also unblocks its shipper
+            const linger abort = {1, 0};
+            follower->dropped = true;
+            follower->pending.clear();
+            setsockopt(follower->socket, SOL_SOCKET, SO_LINGER, &abort,
+                    sizeof(abort));
+            ::shutdown(follower->socket, SHUT_RDWR);
+        } else {
+            follower->pending.insert(follower->pending.end(),
+                    entries.begin(), entries.end());
+        }
+    }
+    entries.clear();
+}  // End of the 'deliver' method
+
+/**
+ * This method will hand the records queued in every bank slot to the
+ * followers.  It is called with the whole bank locked and replMutex held.
+ */
+void deliverQueued() {
+    for (auto& slot : replSlots) {
+        deliver(slot.queue);
+    }
+}  // End of the 'deliverQueued' method
+
+/**
+ * This method will queue a credit or debit for the followers.  It is
+ * called with the calling thread's bank slot held, so the record goes into
+ * that slot's queue without taking any other lock or formatting anything.
+ * Transactions on other slots commute with it, so only creates and resets
+ * need a place in the order (see logExclusive).
+ * 
+ * @param trans The transaction.
+ * @param acct The account number.
+ * @param amt The amount.
+ */
+void logTrans(const char* trans, const std::string& acct, double amt) {
+    if (followerCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    const int slot = threadStripe();
+    auto& queue = replSlots[slot].queue;
+    queue.push_back(makeEntry(trans, acct, amt));
+    if (queue.size() >= SlotBacklog) {
+        // The shippers are falling behind; do not let the queue grow
+        std::lock_guard<std::mutex> guard(replMutex);
+        deliver(queue);
+    }
+}  // End of the 'logTrans' method
+
+/**
+ * This method will send a create or reset to the followers.  It is called
+ * with the whole bank locked, so everything queued in the slots happened
+ * before it and is handed over first.
+ * 
+ * @param trans The transaction.
+ * @param acct The account number.
+ */
+void logExclusive(const char* trans, const std::string& acct) {
+    if (followerCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(replMutex);
+    deliverQueued();
+    std::vector<ReplEntry> entry = {makeEntry(trans, acct)};
+    deliver(entry);
+}  // End of the 'logExclusive' method
+
+/**
+ * This method will hand the records queued in the bank slots to the
+ * followers, locking one slot at a time.  Slots that are busy are skipped
+ * rather than waited for.
+ */
+void collectRepl() {
+    for (int idx = 0; (idx < StripeCount); idx++) {
+        if (!bankLock.tryLockSlot(idx)) {
+            continue;  // Busy: next time, or its transactions hand it over
+        }
+        {
+            std::lock_guard<std::mutex> guard(replMutex);
+            deliver(replSlots[idx].queue);
+        }
+        bankLock.unlockSlot(idx);
+    }
+}  // End of the 'collectRepl' method
+
+/**
+ * This is a method that will act as the main for a thread shipping records
+ * to one follower.  The follower first gets a snapshot of the bank (ending
+ * in a "synced" record), then every transaction after it.  Every ShipPeriod
+ * the thread collects what the transactions queued and writes it out,
+ * formatting it without holding any lock.  Heartbeats are sent while idle.
+ * A follower that falls more than MaxPending records behind is
+ * disconnected.
+ * 
+ * @param stream The iostream associated to the follower connection.
+ */
+void shipToFollower(TcpStreamPtr stream) {
+    using namespace std::chrono;
+    auto follower = std::make_shared<Follower>();
+    follower->socket = stream->socket().native_handle();
+    {
+        // Snapshot the bank with no transactions running.  What is still
+        // queued in the slots is in the snapshot, so it only goes to the
+        // followers that were already there.
+        std::lock_guard<BankLock> bankGuard(bankLock);
+        std::lock_guard<std::mutex> guard(replMutex);
+        deliverQueued();
+        follower->pending.push_back(makeEntry("reset"));
+        for (auto& acct : bank) {
+            follower->pending.push_back(makeEntry("create", acct.first));
+            follower->pending.push_back(makeEntry("credit", acct.first,
+                    acct.second.balance()));
+        }
+        follower->pending.push_back(makeEntry("synced"));
+        follower->maxPending += follower->pending.size();
+        followers.push_back(follower);
+        followerCount++;
+    }
+    auto lastShipped = steady_clock::now();
+    while (*stream) {
+        collectRepl();
+        std::deque<ReplEntry> batch;
+        {
+            std::lock_guard<std::mutex> guard(replMutex);
+            if (follower->dropped) {
+                break;
+            }
+            batch.swap(follower->pending);
+        }
+        const auto now = steady_clock::now();
+        if (batch.empty()) {
+            if (now - lastShipped < HeartbeatPeriod) {
+                std::this_thread::sleep_for(ShipPeriod);
+                continue;
+            }
+            batch.push_back(makeEntry("beat"));
+        }
+        for (const auto& entry : batch) {
+            writeRecord(*stream, entry);
+        }
+        stream->flush();
+        lastShipped = now;
+    }
+    std::lock_guard<std::mutex> guard(replMutex);
+    followers.erase(std::find(followers.begin(), followers.end(), follower));
+    followerCount--;
+}  // End of the 'shipToFollower' method
+
+/**
+ * This is a method that will accept followers on the loopback interface.
+ * 
+ * @param port The port followers connect to.
+ */
+void runReplServer(int port) {
+    io_service service;
+    tcp::acceptor server(service, tcp::endpoint(address_v4::loopback(),
+            port));
+    while (true) {
+        TcpStreamPtr follower = std::make_shared<tcp::iostream>();
+        server.accept(*follower->rdbuf());
+        std::thread thr(shipToFollower, follower);
+        thr.detach();
+    }
+}  // End of the 'runReplServer' method
+
+/**
+ * This method will apply a record from the primary to this follower.
+ * 
+ * @param trans The transaction.
+ * @param acct The account number.
+ * @param amt The amount.
+ */
+void applyRecord(const std::string& trans, const std::string& acct,
+        double amt) {
+    if (trans == "reset") {
+        reset();
+    }
+    if (trans == "create") {
+        openAcct(acct);
+    }
+    if (trans == "credit") {
+        updateAcct(acct, AuditOp::Credit, amt);
+    }
+    if (trans == "debit") {
+        updateAcct(acct, AuditOp::Debit, amt);
+    }
+}  // End of the 'applyRecord' method
+
+/**
+ * This method will add a record from the primary's snapshot to the copy of
+ * the bank being built.  Nobody else can see the copy, so its accounts
+ * never get hot and need no lock.
+ * 
+ * @param snapshot The copy of the bank.
+ * @param trans The transaction.
+ * @param acct The account number.
+ * @param amt The amount.
+ */
+void loadSnapshot(std::unordered_map<std::string, Account>& snapshot,
+        const std::string& trans, const std::string& acct, double amt) {
+    if (trans == "reset") {
+        snapshot.clear();
+    }
+    if (trans == "create") {
+        snapshot.emplace(std::piecewise_construct,
+                std::forward_as_tuple(acct), std::forward_as_tuple());
+    }
+    auto entry = snapshot.find(acct);
+    if (trans == "credit" && entry != snapshot.end()) {
+        entry->second.update(amt);
+    }
+}  // End of the 'loadSnapshot' method
+
+/**
+ * This method will replace the bank with a complete snapshot, all at once,
+ * so clients never see a partly loaded bank.  The old accounts are left in
+ * the snapshot (to be freed outside the lock).
+ * 
+ * @param snapshot The copy of the bank.
+ */
+void installSnapshot(std::unordered_map<std::string, Account>& snapshot) {
+    std::lock_guard<BankLock> guard(bankLock);
+    bank.swap(snapshot);
+    audit(AuditOp::Reset);
+    for (auto& acct : bank) {
+        const double balance = acct.second.balance();
+        audit(AuditOp::Create, acct.first);
+        audit(AuditOp::Credit, acct.first, balance, balance);
+    }
+}  // End of the 'installSnapshot' method
+
+/**
+ * This is a method that will act as the main for the thread following the
+ * primary.  It reconnects (and gets a fresh snapshot) if the primary goes
+ * away.  The snapshot is built on the side and installed once complete;
+ * until then the old bank is served and the lag keeps growing.  A record
+ * that cannot be parsed is reported and skipped; dropping the link would
+ * only bring the same record back in the next snapshot.
+ * 
+ * @param port The port the primary ships records on.
+ */
+void followPrimary(const std::string port) {
+    using namespace std::literals::chrono_literals;
+    while (true) {
+        tcp::iostream primary("localhost", port);
+        setClient(primary.socket());
+        std::unordered_map<std::string, Account> snapshot;
+        bool synced = false;
+        long long primaryMs;
+        std::string line, trans, acct;
+        double amt;
+        while (std::getline(primary, line)) {
+            std::istringstream rec(line);
+            if (!(rec >> primaryMs >> trans >> acct >> amt)) {
+                std::cerr << "Skipping bad record from primary: " << line
+                          << std::endl;
+                continue;
+            }
+            if (synced) {
+                applyRecord(trans, acct, amt);
+            } else if (trans == "synced") {
+                installSnapshot(snapshot);
+                snapshot.clear();
+                synced = true;
+            } else {
+                loadSnapshot(snapshot, trans, acct, amt);
+                continue;
+            }
+            lastPrimaryMs = primaryMs;
+        }
+        std::this_thread::sleep_for(250ms);
+    }
+}  // End of the 'followPrimary' method
+
+/**
+ * This method will check an account number from the binary protocol.  The
+ * HTTP interface can never produce empty ones or ones with white space,
+ * and replication records depend on that.
+ * 
+ * @param acctNum The account number.
+ * @return true if the account number can be used.
+ */
+bool validAcct(const std::string& acctNum) {
+    return !acctNum.empty() && std::none_of(acctNum.begin(), acctNum.end(),
+            [](char c){ return std::isspace(static_cast<unsigned char>(c)); });
+}  // End of the 'validAcct' method
+
+/**
+ * This method will run one binary protocol request.
+ * 
+ * @param req The decoded request.
+ * @return The response to send back.
+ */
+BinResponse execBinary(const BinRequest& req) {
+    BinResponse resp{req.reqId, BinStatus::Ok, 0};
+    const double amt = req.amount / 100.0;
+    double balance;
+    if (role == Role::Follower && req.op != BinOp::Status) {
+        resp.status = BinStatus::ReadOnly;
+        return resp;
+    }
+    if (req.op != BinOp::Reset && !validAcct(req.acct)) {
+        resp.status = BinStatus::BadRequest;
+        return resp;
+    }
+    switch (req.op) {
+        case BinOp::Reset: reset();
+        break;
+        case BinOp::Create:
+            resp.status = openAcct(req.acct) ? BinStatus::Created :
+                    BinStatus::Exists;
+        break;
+        case BinOp::Status:
+            if (acctBalance(req.acct, balance)) {
+                resp.balance = std::llround(balance * 100);
+            } else {
+                resp.status = BinStatus::NotFound;
+            }
+        break;
+        case BinOp::Credit:
+            resp.status = updateAcct(req.acct, AuditOp::Credit, amt) ?
+                    BinStatus::Ok : BinStatus::NotFound;
+        break;
+        case BinOp::Debit:
+            resp.status = updateAcct(req.acct, AuditOp::Debit, amt) ?
+                    BinStatus::Ok : BinStatus::NotFound;
+        break;
+        default: resp.status = BinStatus::BadRequest;
+    }
+    return resp;
+}  // End of the 'execBinary' method
+
+/**
+ * This is a method that will act as the main for a thread serving a binary
+ * protocol client.  Requests may be pipelined; responses are flushed once
+ * no more requests are buffered.  A malformed frame closes the connection.
+ * 
+ * @param stream The iostream associated to the client connection.
+ */
+void serveBinClient(TcpStreamPtr stream) {
+    setClient(stream->socket());
+    BinRequest req;
+    while (readRequest(*stream, req)) {
+        writeResponse(*stream, execBinary(req));
+        if (stream->rdbuf()->in_avail() == 0) {
+            stream->flush();
+        }
+    }
+}  // End of the 'serveBinClient' method
+
+/**
+ * This is a method that will accept binary protocol clients.
+ * 
+ * @param port The port for the binary protocol.
+ */
+void runBinServer(int port) {
+    io_service service;
+    tcp::acceptor server(service, tcp::endpoint(tcp::v4(), port));
+    while (true) {
+        TcpStreamPtr client = std::make_shared<tcp::iostream>();
+        server.accept(*client->rdbuf());
+        std::thread thr(serveBinClient, client);
+        thr.detach();
+    }
+}  // End of the 'runBinServer' method
+
+/**
+ * This method will note the client served by the calling thread, so its
+ * transactions can be audited.
+ * 
+ * @param socket The socket connected to the client.  If the client is
+ * already gone (or not IPv4) it is noted as 0.0.0.0:0.
+ */
+void setClient(basic_socket<tcp>& socket) {
+    boost::system::error_code ec;
+    const tcp::endpoint client = socket.remote_endpoint(ec);
+    const bool known = !ec && client.address().is_v4();
+    clientAddr = known ? client.address().to_v4().to_ulong() : 0;
+    clientPort = known ? client.port() : 0;
+}  // End of the 'setClient' method
+
+/**
+ * This method will record a transaction for the audit trail.  It only
+ * copies a fixed size record into the ring, so it is cheap enough to call
+ * from every transaction.
+ * 
+ * @param op The transaction.
+ * @param acctNum The account number ("" for a reset).
+ * @param amt The amount credited or debited.
+ * @param balance The balance after the transaction.
+ */
+void audit(AuditOp op, const std::string& acctNum, double amt,
+        double balance) {
+    if (!auditRing) {
+        return;
+    }
+    // The coarse clock is a few ns to read (the full one is ~40 ns) but only
+    // ticks every few ms; records stay in order as they pass through the ring
+    timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    AuditRecord rec;
+    rec.timeNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+    rec.amount = amt;
+    rec.balance = balance;
+    rec.clientAddr = clientAddr;
+    rec.clientPort = clientPort;
+    rec.op = op;
+    rec.acctFullLen = acctNum.size();
+    rec.acctLen = std::min<size_t>(acctNum.size(), AuditAcctLen);
+    rec.acctHash = (rec.acctFullLen > rec.acctLen ?
+            std::hash<std::string>()(acctNum) : 0);
+    std::memcpy(rec.acct, acctNum.data(), rec.acctLen);
+    if (!auditRing->push(rec, auditBlock)) {
+        auditDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}  // End of the 'audit' method
+
+/**
+ * This method will write one audit record as a line of text:
+ * "<UTC time> <op> <acct> <amount> <balance> <client>".  A balance of "-"
+ * means the account was hot at the time.  Times are given to the ms, as
+ * the coarse clock they come from is no finer than that.  An account
+ * number too long for the record is written as its first AuditAcctLen
+ * bytes followed by "...[<full length>:<hash in hex>]".
+ * 
+ * @param os The audit file.
+ * @param rec The record to write.
+ */
+void writeAudit(std::ostream& os, const AuditRecord& rec) {
+    static const char* OpNames[] = {"create", "credit", "debit", "reset"};
+    const std::time_t secs = rec.timeNs / 1000000000;
+    std::tm utc;
+    gmtime_r(&secs, &utc);
+    os << std::put_time(&utc, "%Y-%m-%dT%H:%M:%S") << '.'
+       << std::setw(3) << std::setfill('0') << rec.timeNs / 1000000 % 1000
+       << std::setfill(' ') << "Z " << OpNames[static_cast<int>(rec.op)]
+       << ' ' << (rec.acctLen ? std::string(rec.acct, rec.acctLen) : "-");
+    if (rec.acctFullLen > rec.acctLen) {
+        os << "...[" << rec.acctFullLen << ':' << std::hex << rec.acctHash
+           << std::dec << ']';
+    }
+    os << ' ' << std::fixed << std::setprecision(2) << rec.amount << ' ';
+    if (std::isnan(rec.balance)) {
+        os << '-';
+    } else {
+        os << rec.balance;
+    }
+    os << ' ' << address_v4(rec.clientAddr) << ':' << rec.clientPort << '\n';
+}  // End of the 'writeAudit' method
+
+/**
+ * This method will rotate the audit files: file.4 becomes file.5, ...,
+ * and file becomes file.1.  The oldest file is dropped.
+ * 
+ * @param path The audit file.
+ */
+void rotateAudit(const std::string& path) {
+    for (int i = AuditKeep - 1; (i > 0); i--) {
+        std::rename((path + "." + std::to_string(i)).c_str(),
+                (path + "." + std::to_string(i + 1)).c_str());
+    }
+    std::rename(path.c_str(), (path + ".1").c_str());
+}  // End of the 'rotateAudit' method
+
+/**
+ * This is a method that will act as the main for the audit writer thread.
+ * It drains the ring in batches, notes any dropped records, and rotates
+ * the file when it gets too big.  It naps briefly when there is nothing
+ * to write so that producers never have to wake it up.  If the file cannot
+ * be written (or reopened after rotating) that is reported and records
+ * are held in the ring until it can be reopened.  Once told to stop it
+ * empties the ring, flushes the file, and returns.
+ * 
+ * @param path The audit file.
+ * @param out The audit file, already open.
+ */
+void runAuditWriter(const std::string path, std::ofstream out) {
+    using namespace std::literals::chrono_literals;
+    const int BatchSize = 4096;
+    long reported = 0;
+    AuditRecord rec;
+    while (true) {
+        // Records pushed before the stop was asked for are all drained
+        const bool stopping = auditStop.load();
+        if (!out.is_open()) {
+            if (stopping) {
+                std::cerr << "Audit records left in the ring are lost"
+                          << std::endl;
+                return;
+            }
+            out.clear();
+            out.open(path, std::ios::app);
+            if (!out.is_open()) {
+                std::this_thread::sleep_for(100ms);
+                continue;
+            }
+            std::cerr << "Audit file " << path << " reopened" << std::endl;
+        }
+        int batch = 0;
+        while (batch < BatchSize && auditRing->pop(rec)) {
+            writeAudit(out, rec);
+            batch++;
+        }
+        const long dropped = auditDropped.load();
+        if (dropped != reported) {
+            out << "# " << dropped - reported << " records dropped\n";
+            reported = dropped;
+        }
+        if (!out) {
+            std::cerr << "Writing audit file " << path << " failed; "
+                      << "holding records until it can be reopened"
+                      << std::endl;
+            out.close();
+            std::this_thread::sleep_for(100ms);
+            continue;
+        }
+        if (out.tellp() >= auditRotateBytes) {
+            out.close();
+            rotateAudit(path);
+            out.open(path, std::ios::trunc);
+            if (!out.is_open()) {
+                std::cerr << "Reopening audit file " << path << " failed; "
+                          << "holding records until it can be reopened"
+                          << std::endl;
+            }
+        }
+        if (batch == 0) {
+            out.flush();
+            if (stopping) {
+                return;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+}  // End of the 'runAuditWriter' method
+
+/**
+ * This method will start auditing transactions to the given file.
+ * 
+ * @param path The audit file.
+ * @return false if the audit file could not be opened.
+ */
+bool startAudit(const std::string& path) {
+    std::ofstream out(path, std::ios::app);
+    if (!out.is_open()) {
+        return false;
+    }
+    auditRing.reset(new AuditRing());
+    auditWriter = std::thread(runAuditWriter, path, std::move(out));
+    // Registered after the ring was made, so it runs before the ring goes
+    std::atexit(stopAudit);
+    return true;
+}  // End of the 'startAudit' method
+
+/**
+ * This method will stop auditing once no more transactions are running.
+ * Every record already in the ring is written and the file is flushed.
+ * It is called at exit, and may be called earlier (more calls do nothing).
+ */
+void stopAudit() {
+    if (auditWriter.joinable()) {
+        auditStop = true;
+        auditWriter.join();
+    }
+}  // End of the 'stopAudit' method
+
+/**
+ * This method will start the optional services asked for on the command
+ * line after the port: "primary <replPort>", "follow <replPort>",
+ * "binary <binPort>", "audit <file>", "audit-full block|drop" and
+ * "audit-rotate <bytes>".  All options are read (and the audit writer is
+ * started) before any thread that runs transactions is started.
+ * 
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ */
+void startServices(int argc, char** argv) {
+    std::string auditPath, replPort, binPort;
+    for (int arg = 2; (arg + 1 < argc); arg += 2) {
+        const std::string mode = argv[arg], value = argv[arg + 1];
+        if (mode == "primary" || mode == "follow") {
+            role = (mode == "primary" ? Role::Primary : Role::Follower);
+            replPort = value;
+        }
+        if (mode == "binary") {
+            binPort = value;
+        }
+        if (mode == "audit") {
+            auditPath = value;
+        }
+        if (mode == "audit-full") {
+            auditBlock = (value == "block");
+        }
+        if (mode == "audit-rotate") {
+            auditRotateBytes = std::stol(value);
+        }
+    }
+    if (!auditPath.empty()) {
+        // The audit trail is required: do not run without it
+        if (!startAudit(auditPath)) {
+            std::cerr << "Unable to open audit file " << auditPath
+                      << std::endl;
+            std::exit(1);
+        }
+        std::cout << "Auditing transactions to " << auditPath << std::endl;
+    }
+    if (role == Role::Primary) {
+        std::thread thr(runReplServer, std::stoi(replPort));
+        thr.detach();
+        std::cout << "Shipping transactions to followers on port "
+                  << replPort << std::endl;
+    }
+    if (role == Role::Follower) {
+        std::thread thr(followPrimary, replPort);
+        thr.detach();
+        std::cout << "Following primary on port " << replPort << std::endl;
+    }
+    if (!binPort.empty()) {
+        std::thread thr(runBinServer, std::stoi(binPort));
+        thr.detach();
+        std::cout << "Listening for binary requests on port " << binPort
+                  << std::endl;
+    }
+}  // End of the 'startServices' method
+
 /**
  * Top-level method to run a custom HTTP server to process bank
  * transaction requests using multiple threads. Each request should
@@ -258,11 +1667,12 @@ void thrdInit(TcpStreamPtr stream) {
 void runServer(tcp::acceptor& server) {
     // Process client connections one-by-one...forever
     while (true) {       
-//        TcpStreamPtr client = std::make_shared<tcp::iostream>();
-        tcp::iostream client;
+        TcpStreamPtr client = std::make_shared<tcp::iostream>();
         // Wait for a client to connect
-        server.accept(*client.rdbuf());
-        serveClient(client, client);
+        server.accept(*client->rdbuf());
+        // Serve the client on a detached thread
+        std::thread thr(thrdInit, client);
+        thr.detach();
     }
 }  // End of the 'runServer' method
 
@@ -303,6 +1713,10 @@ std::string url_decode(std::string str) {
 
 // Helper method for testing.
 void checkRunClient(const std::string& port);
+// Zipfian hot-account benchmark (see bank_bench.cpp).
+int runZipfBench(int argc, char** argv);
+// Starts auditing, replication and the binary listener (command line).
+void startServices(int argc, char** argv);
 
 /*
  * The main method that performs the basic task of accepting
@@ -310,6 +1724,9 @@ void checkRunClient(const std::string& port);
  * multiple threads.
  */
 int main(int argc, char** argv) {  
+#ifdef ZIPF_BENCH
+    return runZipfBench(argc, argv);
+#endif
     // Setup the port number for use by the server
     const int port = (argc > 1 ? std::stoi(argv[1]) : 0);
     io_service service;
@@ -319,6 +1736,7 @@ int main(int argc, char** argv) {
     // Print information where the server is operating.    
     std::cout << "Listening for commands on port "
               << server.local_endpoint().port() << std::endl;
+    startServices(argc, argv);
     // Check run tester client.
 #ifdef TEST_CLIENT
     checkRunClient(argv[1]);
@@ -0,0 +1,64 @@
+#!/bin/bash
+#
+# Replication test on one box.  Starts a primary and a follower, writes
+# through the primary (repl_primary_req.txt) and checks reads on the
+# follower (repl_follower_req.txt), including its X-Replica-Lag-Ms header.
+# A second follower started afterwards checks catching up from a snapshot.
+#
+# Usage: ./repl_test.sh [server] [client]
+#
+
+SERVER=${1:-./CSE-381-hw08}
+CLIENT=${2:-./bank_client}
+PORT=9400        # HTTP port of the primary
+REPL_PORT=9401   # Port the primary ships transactions on
+FOLLOW1=9402     # HTTP port of the first follower
+FOLLOW2=9403     # HTTP port of the late follower
+MAX_LAG_MS=1000  # Most a follower may lag behind when idle
+
+status=0
+pids=()
+trap 'kill "${pids[@]}" 2> /dev/null' EXIT
+
+# Helper to run a request file and fail on any error reported by the client
+runReqs() {
+    local errs
+    errs=$("$CLIENT" "$1" "$2" 2>&1 > /dev/null)
+    if [ -n "$errs" ]; then
+        echo "FAIL: $1 on port $2"
+        echo "$errs"
+        status=1
+    fi
+}
+
+# Helper to check the lag a follower reports
+checkLag() {
+    local lag
+    exec 3<> /dev/tcp/localhost/"$1"
+    printf 'GET /trans=status&acct=0x01 HTTP/1.1\r\nHost: localhost\r\n\r\n' >&3
+    lag=$(tr -d '\r' <&3 | grep -a '^X-Replica-Lag-Ms: ' | cut -d' ' -f2)
+    exec 3<&-
+    if [ -z "$lag" ] || [ "$lag" -gt "$MAX_LAG_MS" ]; then
+        echo "FAIL: follower on port $1 reports lag '$lag' ms"
+        status=1
+    fi
+}
+
+"$SERVER" $PORT primary $REPL_PORT > /dev/null & pids+=($!)
+"$SERVER" $FOLLOW1 follow $REPL_PORT > /dev/null & pids+=($!)
+sleep 0.5
+
+# Streamed to a follower that is already connected
+runReqs repl_primary_req.txt $PORT
+sleep 0.5
+runReqs repl_follower_req.txt $FOLLOW1
+checkLag $FOLLOW1
+
+# Snapshot for a follower that connects later
+"$SERVER" $FOLLOW2 follow $REPL_PORT > /dev/null & pids+=($!)
+sleep 0.5
+runReqs repl_follower_req.txt $FOLLOW2
+checkLag $FOLLOW2
+
+[ $status -eq 0 ] && echo "Replication test passed."
+exit $status